@@ -0,0 +1,260 @@
+/* adc.c */
+/*
+
+ADC driver.
+- Timer 0 auto-triggered conversions
+- Double buffered sample blocks handed to a consumer task
+
+*/
+
+#include "adc.h"
+
+#define ADC_MAX_CLOCK 200000UL  /* Max ADC clock for 10-bit resolution */
+#define ADC_CONV_CYCLES 14      /* ADC clocks per auto-triggered conversion */
+
+/* ADC clock prescaler - Fastest one within ADC_MAX_CLOCK */
+#if (F_CPU / 2UL) <= ADC_MAX_CLOCK
+#define ADC_PRESCALER 2
+#define ADC_PS_BITS ((1 << ADPS0))
+#elif (F_CPU / 4UL) <= ADC_MAX_CLOCK
+#define ADC_PRESCALER 4
+#define ADC_PS_BITS ((1 << ADPS1))
+#elif (F_CPU / 8UL) <= ADC_MAX_CLOCK
+#define ADC_PRESCALER 8
+#define ADC_PS_BITS ((1 << ADPS1) | (1 << ADPS0))
+#elif (F_CPU / 16UL) <= ADC_MAX_CLOCK
+#define ADC_PRESCALER 16
+#define ADC_PS_BITS ((1 << ADPS2))
+#elif (F_CPU / 32UL) <= ADC_MAX_CLOCK
+#define ADC_PRESCALER 32
+#define ADC_PS_BITS ((1 << ADPS2) | (1 << ADPS0))
+#elif (F_CPU / 64UL) <= ADC_MAX_CLOCK
+#define ADC_PRESCALER 64
+#define ADC_PS_BITS ((1 << ADPS2) | (1 << ADPS1))
+#else
+#define ADC_PRESCALER 128
+#define ADC_PS_BITS ((1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0))
+#endif
+
+/* Highest sample rate the ADC keeps up with */
+#define ADC_MAX_RATE (F_CPU / ADC_PRESCALER / ADC_CONV_CYCLES)
+
+_Static_assert (ADC_BLOCK_SIZE > 0 && ADC_BLOCK_SIZE <= 255,
+                "ADC_BLOCK_SIZE must be within 1..255");
+
+LOCAL STATUS timer0Setup (UINT16 sampleRate);
+
+/* Sample blocks - The ISR fills one, the consumer reads the other */
+LOCAL UINT16 adcBlocks [2][ADC_BLOCK_SIZE];
+
+LOCAL UINT8 adcChannels [ADC_MAX_CHANNELS]; /* Channel list to step */
+LOCAL UINT8 adcChannelCount = 0;
+LOCAL volatile UINT8 adcChannelIdx = 0;     /* Channel being converted */
+LOCAL volatile UINT8 fillBlock = 0;         /* Block the ISR writes */
+LOCAL volatile UINT8 fillIdx = 0;           /* Next sample in fillBlock */
+LOCAL volatile UINT8 readyPending = 0;      /* Other block full, not taken */
+LOCAL volatile UINT8 blockHeld = 0;         /* Consumer works on the other */
+LOCAL volatile UINT16 overruns = 0;         /* Blocks the consumer missed */
+LOCAL wTask_t * adcConsumer = NULL;         /* Task woken per block */
+LOCAL UINT8 timer0Clock = 0;                /* Timer 0 CS bits */
+
+/* Init ADC sampling - sampleRate is conversions per second over all
+ * channels. Blocks hold ADC_BLOCK_SIZE samples, channels interleaved */
+IMPORT STATUS adc_init(const UINT8 * channels,
+                       UINT8 nChannels,
+                       UINT16 sampleRate,
+                       wTask_t * consumer)
+    {
+    UINT8 didr = 0;
+
+    /* Sanity checks */
+    if (channels == NULL || consumer == NULL ||
+        nChannels == 0U || nChannels > ADC_MAX_CHANNELS ||
+        (ADC_BLOCK_SIZE % nChannels) != 0U ||
+        sampleRate == 0U || sampleRate > ADC_MAX_RATE)
+        {
+        return ERROR;
+        }
+
+    for (UINT8 i = 0; i < nChannels; i++)
+        {
+        if (channels[i] >= ADC_MAX_CHANNELS)
+            {
+            return ERROR;
+            }
+        adcChannels[i] = channels[i];
+
+        /* ADC6 and ADC7 have no digital input */
+        if (channels[i] < 6U)
+            {
+            didr |= (1 << channels[i]);
+            }
+        }
+
+    adc_stop();
+
+    if (timer0Setup (sampleRate) != OK)
+        {
+        return ERROR;
+        }
+
+    adcChannelCount = nChannels;
+    adcChannelIdx = 0;
+    adcConsumer = consumer;
+    fillBlock = 0;
+    fillIdx = 0;
+    readyPending = 0;
+    blockHeld = 0;
+    overruns = 0;
+
+    /* Disable digital inputs on the sampled pins */
+    DIDR0 |= didr;
+
+    /* AVcc reference, 1st channel */
+    ADMUX = (1 << REFS0) | adcChannels[0];
+
+    /* Trigger source: Timer 0 compare match A */
+    ADCSRB = (1 << ADTS1) | (1 << ADTS0);
+
+    /* Enable, auto trigger, interrupt */
+    ADCSRA = (1 << ADEN) | (1 << ADATE) | (1 << ADIE) | ADC_PS_BITS;
+
+    return OK;
+    }
+
+/* Starts the sampling timer */
+IMPORT void adc_start(void)
+    {
+    TCNT0 = 0;
+    TIFR0 = (1 << OCF0A);
+    TCCR0B = timer0Clock;
+    }
+
+/* Stops the sampling timer - A running conversion still completes */
+IMPORT void adc_stop(void)
+    {
+    TCCR0B = 0;
+    }
+
+/* Waits for a full block - timeout in ticks or W_WAIT_FOREVER, restarts
+ * on a wake-up without a block. Returns NULL on timeout
+ * Call adc_release_block() when done with it */
+IMPORT const UINT16 * adc_wait_block(UINT16 timeout)
+    {
+    const UINT16 * block = NULL;
+
+    while (1)
+        {
+        cli();  /* Disable ISR */
+
+        if (readyPending != 0U)
+            {
+            /* The ready block is the one the ISR is not filling */
+            readyPending = 0;
+            blockHeld = 1;
+            block = adcBlocks[fillBlock ^ 1U];
+            sei();
+            return block;
+            }
+
+        sei();  /* Enable ISR */
+
+        /* A block ready meanwhile is counted - Returns right away */
+        if (wTaskNotifyWait (timeout) != OK)
+            {
+            return NULL; /* Timed out */
+            }
+        }
+    }
+
+/* Gives the block from adc_wait_block() back to the driver */
+IMPORT void adc_release_block(void)
+    {
+    blockHeld = 0;
+    }
+
+/* Blocks dropped because the consumer was late */
+IMPORT UINT16 adc_overruns(void)
+    {
+    UINT16 count = 0;
+    UINT8 sreg = SREG;
+
+    cli();
+    count = overruns;
+    SREG = sreg;
+
+    return count;
+    }
+
+/* Timer 0 in CTC - Compare match A triggers one conversion */
+LOCAL STATUS timer0Setup (UINT16 sampleRate)
+    {
+    LOCAL const UINT16 prescalers [] = {8, 64, 256, 1024};
+    LOCAL const UINT8 clocks [] =
+        {
+        (1 << CS01),
+        (1 << CS01) | (1 << CS00),
+        (1 << CS02),
+        (1 << CS02) | (1 << CS00)
+        };
+
+    for (UINT8 i = 0; i < sizeof (prescalers) / sizeof (prescalers[0]); i++)
+        {
+        UINT32 counts = F_CPU / ((UINT32) prescalers[i] * sampleRate);
+
+        if (counts >= 1U && counts <= 256U)
+            {
+            TCCR0A = (1 << WGM01);  /* CTC */
+            TCCR0B = 0;             /* Stopped until adc_start() */
+            TIMSK0 = 0;             /* The ADC takes the compare flag */
+            OCR0A = (UINT8)(counts - 1U);
+            timer0Clock = clocks[i];
+            return OK;
+            }
+        }
+
+    return ERROR;
+    }
+
+/* Conversion complete - Store the sample, hand full blocks over */
+W_ISR (ADC_vect)
+    {
+    UINT16 sample = ADC;
+
+    /* Next conversion has not started yet - Select its channel now */
+    if (++adcChannelIdx >= adcChannelCount)
+        {
+        adcChannelIdx = 0;
+        }
+    ADMUX = (ADMUX & 0xF0) | adcChannels[adcChannelIdx];
+
+    /* Auto trigger fires on the flag edge - Clear it for the next one
+     * Only after ADMUX - The mux is safe to change until the flag clears */
+    TIFR0 = (1 << OCF0A);
+
+    adcBlocks[fillBlock][fillIdx] = sample;
+    if (++fillIdx < ADC_BLOCK_SIZE)
+        {
+        return;
+        }
+    fillIdx = 0;
+
+    if (blockHeld != 0U)
+        {
+        /* Consumer still on the other block - Drop this one */
+        overruns++;
+        return;
+        }
+
+    if (readyPending != 0U)
+        {
+        /* Other block never taken - Replace it, wake-up already sent */
+        overruns++;
+        fillBlock ^= 1U;
+        return;
+        }
+
+    readyPending = 1;
+    fillBlock ^= 1U;
+    wTaskNotifyFromISR (adcConsumer);
+    }
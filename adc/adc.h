@@ -0,0 +1,54 @@
+/* adc.h */
+
+#ifndef ADC_H
+#define ADC_H
+
+#include <stdio.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "common.h"
+#include "uWire.h"
+#include "adc.h"
+
+/*
+
+Interrupt driven ADC sampling.
+
+Timer 0 compare match A auto-triggers the conversions at the sample
+rate. The ADC ISR stores each result in one of two blocks and steps
+through the channel list. When a block is full it wakes the consumer
+task. The consumer works on that block while the ISR fills the other
+one. Samples of the channels are interleaved in the block.
+
+Timer 0 is taken by this driver (uWire uses timers 1 and 2).
+
+    adc_init (channels, 2, 2000, adcTask);
+    adc_start ();
+
+    adcTask:
+        while (1)
+            {
+            const UINT16 * block = adc_wait_block (W_WAIT_FOREVER);
+            process (block, ADC_BLOCK_SIZE);
+            adc_release_block ();
+            }
+
+*/
+
+#ifndef ADC_BLOCK_SIZE
+#define ADC_BLOCK_SIZE 32       /* Samples per block - 2 blocks in RAM */
+#endif
+
+#define ADC_MAX_CHANNELS 8      /* ADC0..ADC7 */
+
+IMPORT STATUS adc_init(const UINT8 * channels,
+                       UINT8 nChannels,
+                       UINT16 sampleRate,
+                       wTask_t * consumer);
+IMPORT void adc_start(void);
+IMPORT void adc_stop(void);
+IMPORT const UINT16 * adc_wait_block(UINT16 timeout);
+IMPORT void adc_release_block(void);
+IMPORT UINT16 adc_overruns(void);
+
+#endif /* ADC_H */
@@ -34,6 +34,6 @@ LOCAL int uart_putc(char c, FILE *stream) {
 }
 
 IMPORT void serial_init(UINT32 baud) {
-    uart_init(16000000/(16 * baud) -1);
+    uart_init(F_CPU / (16UL * baud) - 1);
     stdout = &uart_stdout; // Redirect stdout
 }
\ No newline at end of file
@@ -21,6 +21,11 @@ LOCAL void blinky1Task (void);
 LOCAL void blinky2Task (void);
 LOCAL void blinky3Task (void);
 
+/* Task descriptors - Kept in flash */
+W_TASK_DESC (blinky1Desc, &blinky1Task, "blink1", MINIMAL_STACK_SIZE);
+W_TASK_DESC (blinky2Desc, &blinky2Task, "blinky2", MINIMAL_STACK_SIZE);
+W_TASK_DESC (blinky3Desc, &blinky3Task, "blink3", MINIMAL_STACK_SIZE);
+
 // Main - Entry point
 int main (void)
     {
@@ -34,15 +39,9 @@ int main (void)
     initScheduler();
 
     /* Create tasks */
-    wTask_t * blinky2TaskCtrl = wTaskCreate (&blinky2Task, 
-                                            "blinky2", 
-                                            MINIMAL_STACK_SIZE);
-    wTask_t * blinkCtrlBlock = wTaskCreate (&blinky1Task, 
-                                            "blink1", 
-                                            MINIMAL_STACK_SIZE);
-    wTask_t * blink3CtrlBlock = wTaskCreate (&blinky3Task, 
-                                            "blink3", 
-                                            MINIMAL_STACK_SIZE);
+    wTask_t * blinky2TaskCtrl = wTaskCreate (&blinky2Desc);
+    wTask_t * blinkCtrlBlock = wTaskCreate (&blinky1Desc);
+    wTask_t * blink3CtrlBlock = wTaskCreate (&blinky3Desc);
 
     /* Main loop is used as Idle Task */
     while (1)
@@ -22,22 +22,69 @@ LOCAL void timer1Setup (void);
 LOCAL void timer2Setup (void);
 LOCAL void fillStackContext (wTask_t * taskCtrl);
 LOCAL wTask_t * createMainTask (void);
-LOCAL wTask_t * createIdleTask (wTaskHandler taskFn, UINT16 stackSize);
-LOCAL STATUS insertTaskNode (wTask_t * taskCtrl);
+LOCAL wTask_t * createIdleTask (void);
+LOCAL void insertTask (wTask_t * taskCtrl);
 LOCAL void wTaskYield(void);
 LOCAL void idleTask (void);
+LOCAL wTask_t * createTask (const wTaskDesc_t * desc);
+LOCAL void selectNextTask (void);
+LOCAL UINT8 processTick (void);
+LOCAL UINT8 preemptsCurrent (wTask_t * task);
+LOCAL UINT8 isrWakePreempts (wTask_t * task);
+LOCAL UINT8 notifyTask (wTask_t * task);
+LOCAL UINT8 wakeObjectTask (wTask_t * task, void * obj);
+LOCAL void isrWake (wTask_t * task);
+#if W_USE_STATS
+LOCAL UINT32 statsTimeStamp (void);
+LOCAL void statsRecord (wTaskStats_t * stats, UINT32 segment);
+LOCAL void statsDump (wTask_t * task);
+#endif /* W_USE_STATS */
+#if W_USE_EDF
+LOCAL UINT16 taskPeriod (wTask_t * task);
+LOCAL void edfRelease (wTask_t * task);
+LOCAL void edfInsert (wTask_t * task);
+LOCAL void edfRemove (wTask_t * task);
+#endif /* W_USE_EDF */
 
 void TIMER1_COMPA_vect(void) __attribute__ ( ( signal, naked ) );
 void TIMER2_COMPA_vect(void) __attribute__ ( ( signal, naked ) );
+void wIsrContextSwitch(void) __attribute__ ( ( naked, used ) );
 void wtaskSwitcher (void);
-void wTickManagment (void);
+UINT8 wTickManagment (void);
 void disableTimer2 (void);
 
+#if W_USE_HEAP
+#define kernelAlloc(size) calloc (1, (size))
+#define kernelFree(ptr) free (ptr)
+#else
+/* Arena memory is never given back */
+#define kernelFree(ptr) ((void) (ptr))
+LOCAL void * kernelAlloc (UINT16 size);
+#endif /* W_USE_HEAP */
+
 /* Globals */
 
 wTask_t * volatile wCurrentTask = NULL; /* Save current taks stack */
-wTaskNode_t * volatile taskHeadNode = NULL; /* List of tasks TCB */
+wTask_t * volatile taskHead = NULL; /* List of tasks TCB */
 wTask_t * volatile wIdleTask = NULL; /* Idle task for scheduller */
+volatile UINT32 wTickCount = 0; /* Ticks elapsed since timer start */
+volatile UINT8 wYieldFromISR = 0; /* An ISR woke a task that has to run */
+LOCAL wTask_t * volatile wakeHint = NULL; /* Task woken by an ISR */
+LOCAL volatile UINT8 schedulerSuspended = 0; /* Suspend nesting count */
+LOCAL volatile UINT16 pendingTicks = 0; /* Ticks held while suspended */
+LOCAL volatile UINT8 yieldPending = 0; /* Switch held while suspended */
+#if !W_USE_HEAP
+LOCAL UINT8 kernelArena [W_KERNEL_ARENA_SIZE]; /* TCBs, nodes and stacks */
+LOCAL UINT16 kernelArenaUsed = 0; /* Bytes taken from the arena */
+#endif /* !W_USE_HEAP */
+/* Kernel task descriptors */
+W_TASK_DESC (mainTaskDesc, NULL, "main", 0); /* Runs on the C stack */
+W_TASK_DESC (idleTaskDesc, &idleTask, "idle", IDLE_TASK_STACK);
+
+#if W_USE_EDF
+LOCAL wTask_t * volatile edfHead = NULL; /* Released jobs by deadline */
+LOCAL wOverrunHook edfOverrunHook = NULL; /* Deadline miss hook */
+#endif /* W_USE_EDF */
 
 /*******************************************************************************
 * API Tasks functions
@@ -49,7 +96,7 @@ IMPORT void initScheduler(void)
     wTask_t * mainTaskCtrl = NULL;
 
     /* Create idle task */
-    wIdleTask = createIdleTask (&idleTask, IDLE_TASK_STACK);
+    wIdleTask = createIdleTask ();
     if (wIdleTask == NULL)
         {
         CRITICAL_LOG ("Fail creating task for idle");
@@ -70,120 +117,483 @@ IMPORT void initScheduler(void)
     timerSetup();
     }
 
-/* Creates tasks */
-IMPORT wTask_t * wTaskCreate(wTaskHandler taskFn,
-                            const char name[12],
-                            UINT16 stackSize)
+/* Creates tasks - desc has to be in flash, see W_TASK_DESC */
+IMPORT wTask_t * wTaskCreate(const wTaskDesc_t * desc)
     {
     wTask_t * taskCtrl = NULL;
+
+#if W_USE_EDF
+    UINT16 period = 0;
+    UINT16 deadline = 0;
+
+    if (desc != NULL)
+        {
+        period = pgm_read_word (&desc->period);
+        deadline = pgm_read_word (&desc->deadline);
+        }
+
+    /* Sanity checks - deadline 0 means deadline = period */
+    if (period != 0U && deadline > period)
+        {
+        CRITICAL_LOG("Fail on wTaskCreate - Invalid period/deadline");
+        return NULL;
+        }
+#endif /* W_USE_EDF */
     
     /* Disable ISR */
     cli();
 
-    /* Sanity checks */
-    if (taskFn == NULL || name == NULL)
+    taskCtrl = createTask (desc);
+
+#if W_USE_EDF
+    if (taskCtrl != NULL && period != 0U)
         {
-        CRITICAL_LOG("Fail on wTaskCreate - Initial sanity checks");
-        return NULL;
+        /* 1st job of a periodic task is released now */
+        taskCtrl->nextRelease = wTickCount;
+        edfRelease (taskCtrl);
         }
+#endif /* W_USE_EDF */
 
-    /* Create task ctrl */
-    taskCtrl = (wTask_t *) calloc (1, sizeof (wTask_t));
-    if ( taskCtrl == NULL)
+    /* Enable ISR */
+    sei();
+
+    return taskCtrl;
+    }
+
+#if W_USE_EDF
+/* Ends the current job of a periodic task and waits for the next release */
+IMPORT STATUS wTaskWaitNextPeriod(void)
+    {
+    volatile wTask_t * task = wCurrentTask;
+
+    /* Can not block while the scheduler is suspended */
+    if (task == NULL || taskPeriod ((wTask_t *) task) == 0U ||
+        schedulerSuspended != 0U)
         {
-        CRITICAL_LOG("Fail on wTaskCreate - Fail to allocate heap for task");
-        return NULL;
+        return ERROR;
         }
-    
-    (void) strcpy (taskCtrl->name, name);
-    taskCtrl->taskFn = taskFn;
-    taskCtrl->stackSize = stackSize;
-    taskCtrl->taskStatus = TASK_RUNNING;
 
-    taskCtrl->stackPtr = (void *) malloc (stackSize);
-    if (taskCtrl->stackPtr == NULL)
+    cli();  /* Disable ISR */
+
+    edfRemove ((wTask_t *) task);
+
+    if ((int32_t)(wTickCount - task->nextRelease) >= 0)
         {
-        CRITICAL_LOG("Fail on wTaskCreate - Fail to "
-                    "allocate heap for task stack");
-        free (taskCtrl);
-        return NULL;        
+        /* Overrun - next job is already due */
+        edfRelease ((wTask_t *) task);
+        sei();
+        return OK;
         }
-    (void) memset (taskCtrl->stackPtr, 0, stackSize);
 
-    /* Fill stack context */
-    fillStackContext(taskCtrl);
+    /* Tick management releases the next job */
+    task->taskStatus = TASK_PERIOD_WAIT;
 
-    if (insertTaskNode (taskCtrl) != OK)
+    sei();  /* Enable ISR */
+
+    /* Trigger context switch */
+    wTaskYield();
+
+    /* The yield ISR fires a few cycles later - Wait for the release */
+    while (task->taskStatus != TASK_RUNNING)
         {
-        CRITICAL_LOG("Fail on wTaskCreate - Fail to add task to the list");
-        free (taskCtrl->stackPtr);
-        free (taskCtrl);
-        return NULL;
         }
 
-    /* Enable ISR */
-    sei();
+    return OK;
+    }
 
-    return taskCtrl;
+/* Sets the hook called (from the tick ISR) when a job misses its deadline */
+IMPORT void wTaskSetOverrunHook(wOverrunHook hook)
+    {
+    edfOverrunHook = hook;
     }
+#endif /* W_USE_EDF */
 
 IMPORT void hexDumpStack(wTask_t *task)
     {
     UINT8 *sp = (UINT8 *)task->stackPtr;
+    UINT16 stackSize = pgm_read_word (&task->desc->stackSize);
     printf("\n\n");
     printf("Stack dump from fabricated SP:\n");
-    for (uint16_t i = 0; i < task->stackSize; i += 16)
+    for (uint16_t i = 0; i < stackSize; i += 16)
     {
         printf("0x%04X: ", (unsigned)(sp + i));
-        for (UINT8 j = 0; j < 16 && (i + j) < task->stackSize; ++j)
+        for (UINT8 j = 0; j < 16 && (i + j) < stackSize; ++j)
         {
             printf("%02X ", sp[i + j]);
         }
         printf("\n");
     }
-    UINT16 taskAddr = (UINT16) task->taskFn;
+    UINT16 taskAddr = pgm_read_word (&task->desc->taskFn);
     printf ("Low Byte: %02X. High Byte: %02X\n", 
             (UINT8)(taskAddr & 0xFF), 
             (UINT8)((taskAddr >> 8) & 0xFF));
     }
 
-IMPORT STATUS wTaskDelay(UINT64 ticks)
+IMPORT STATUS wTaskDelay(UINT16 ticks)
     {
-    if (ticks == 0U || wCurrentTask == NULL)
+    volatile wTask_t * task = wCurrentTask;
+
+    /* Can not block while the scheduler is suspended */
+    if (ticks == 0U || task == NULL || schedulerSuspended != 0U)
         {
         return ERROR;
         }
 
+    cli();  /* Disable ISR */
+
     /* Set to number of ticks to wait */
-    wCurrentTask->ticksToDelay = ticks;
+    task->ticksToDelay = ticks;
     
     /* Set the task to STOPPED */
-    wCurrentTask->taskStatus = TASK_STOPPED;
+    task->taskStatus = TASK_STOPPED;
+
+    sei();  /* Enable ISR */
     
     /* Trigger context switch */
     wTaskYield();
 
+    /* The yield ISR fires a few cycles later - Wait to be switched out */
+    while (task->taskStatus != TASK_RUNNING)
+        {
+        }
+
     return OK;
     }
 
+#if W_USE_NAMES
 IMPORT wTask_t * acquireTaskByName(const char * taskName)
     {
-    wTaskNode_t * node = taskHeadNode;
+    wTask_t * task = taskHead;
 
     /* Iterate each task */
-    while (node != NULL)
+    while (task != NULL)
         {
-        wTask_t * task = node->task;
+        PGM_P name = (PGM_P) pgm_read_word (&task->desc->name);
 
-        if (strncmp(taskName, task->name, 12) == 0)
+        if (name != NULL && strncmp_P (taskName, name, 12) == 0)
             {
             return task; /* Task Found */
             }
-        node = node->next;
+        task = task->next;
         }
     
     return NULL; /* No task Found */
     }
+#endif /* W_USE_NAMES */
+
+/* Sets the time slice of a task in ticks - 0 makes it cooperative only */
+IMPORT STATUS wTaskSetTimeSlice(wTask_t * task, UINT8 ticks)
+    {
+    UINT8 sreg = 0;
+
+    if (task == NULL)
+        {
+        return ERROR;
+        }
+
+    sreg = SREG;
+    cli();
+    task->timeSlice = ticks;
+    task->sliceLeft = ticks;
+    SREG = sreg;
+
+    return OK;
+    }
+
+/* Waits for a notification - timeout in ticks, W_WAIT_FOREVER for none
+ * Returns ERROR on timeout */
+IMPORT STATUS wTaskNotifyWait(UINT16 timeout)
+    {
+    volatile wTask_t * task = wCurrentTask;
+
+    /* Can not block while the scheduler is suspended */
+    if (task == NULL || schedulerSuspended != 0U)
+        {
+        return ERROR;
+        }
+
+    cli();  /* Disable ISR */
+
+    if (task->notifyCount == 0U)
+        {
+        task->ticksToDelay = timeout;
+        task->taskStatus = TASK_BLOCKED;
+
+        sei();  /* Enable ISR */
+
+        /* Trigger context switch */
+        wTaskYield();
+
+        /* The yield ISR fires a few cycles later - Wait to be woken up */
+        while (task->taskStatus != TASK_RUNNING)
+            {
+            }
+
+        cli();  /* Disable ISR */
+        }
+
+    if (task->notifyCount == 0U)
+        {
+        sei();
+        return ERROR; /* Timed out */
+        }
+
+    task->notifyCount--;
+
+    sei();  /* Enable ISR */
+
+    return OK;
+    }
+
+/* Notifies a task from task context - Wakes it if it is waiting */
+IMPORT STATUS wTaskNotify(wTask_t * task)
+    {
+    UINT8 woken = 0;
+
+    if (task == NULL)
+        {
+        return ERROR;
+        }
+
+    cli();  /* Disable ISR */
+
+    woken = notifyTask (task);
+
+    sei();  /* Enable ISR */
+
+    /* Only hand over the CPU if the woken task goes before this one */
+    if (woken != 0U && preemptsCurrent (task) != 0U)
+        {
+        wTaskYield();
+        }
+
+    return OK;
+    }
+
+/* Notifies a task from an ISR - Use within W_ISR to switch on ISR exit */
+IMPORT void wTaskNotifyFromISR(wTask_t * task)
+    {
+    if (notifyTask (task) != 0U)
+        {
+        isrWake (task);
+        }
+    }
+
+/* Waits for a wake-up on obj - See wTaskWakeObject()
+ * Call with ISR disabled right after checking the wait condition, so no
+ * wake-up is lost in between. Returns with ISR enabled - The caller
+ * checks its wait condition again. Does not touch the notifications */
+IMPORT STATUS wTaskWaitObject(void * obj, UINT16 timeout)
+    {
+    volatile wTask_t * task = wCurrentTask;
+    STATUS status = OK;
+
+    /* Can not block while the scheduler is suspended */
+    if (obj == NULL || task == NULL || schedulerSuspended != 0U)
+        {
+        sei();
+        return ERROR;
+        }
+
+    /* The waker clears waitObj - Still set after the wait is a timeout */
+    task->waitObj = obj;
+    task->ticksToDelay = timeout;
+    task->taskStatus = TASK_BLOCKED;
+
+    sei();  /* Enable ISR */
+
+    /* Trigger context switch */
+    wTaskYield();
+
+    /* The yield ISR fires a few cycles later - Wait to be woken up */
+    while (task->taskStatus != TASK_RUNNING)
+        {
+        }
+
+    cli();  /* Disable ISR */
+
+    if (task->waitObj != NULL)
+        {
+        task->waitObj = NULL;
+        status = ERROR; /* Timed out */
+        }
+
+    sei();  /* Enable ISR */
+
+    return status;
+    }
+
+/* Wakes every task waiting on obj - Task context */
+IMPORT void wTaskWakeObject(void * obj)
+    {
+    wTask_t * task = taskHead;
+    UINT8 yield = 0;
+
+    cli();  /* Disable ISR */
+
+    while (task != NULL)
+        {
+        if (wakeObjectTask (task, obj) != 0U)
+            {
+            yield |= preemptsCurrent (task);
+            }
+        task = task->next;
+        }
+
+    sei();  /* Enable ISR */
+
+    if (yield != 0U)
+        {
+        wTaskYield();
+        }
+    }
+
+/* Wakes every task waiting on obj - ISR context */
+IMPORT void wTaskWakeObjectFromISR(void * obj)
+    {
+    wTask_t * task = taskHead;
+
+    while (task != NULL)
+        {
+        if (wakeObjectTask (task, obj) != 0U)
+            {
+            isrWake (task);
+            }
+        task = task->next;
+        }
+    }
+
+/* Suspends task switching - Nests, ISR stay enabled
+ * Blocking calls return ERROR until the matching wSchedulerResume()
+ * Up to 0xFFFF ticks are held (655 s at 100 Hz) - Later ones are lost */
+IMPORT void wSchedulerSuspend(void)
+    {
+    UINT8 sreg = SREG;
+
+    cli();
+    if (schedulerSuspended < 0xFF)
+        {
+        schedulerSuspended++;
+        }
+
+    /* A yield armed just before still has to fire - Hold it instead */
+    if ((TIMSK2 & (1 << OCIE2A)) != 0U)
+        {
+        disableTimer2();
+        yieldPending = 1;
+        }
+    SREG = sreg;
+    }
+
+/* Resumes task switching - The outermost call replays the ticks held
+ * while suspended and does a single switch if any was requested */
+IMPORT void wSchedulerResume(void)
+    {
+    UINT8 reschedule = 0;
+
+    cli();  /* Disable ISR */
+
+    if (schedulerSuspended == 0U)
+        {
+        sei();
+        return;
+        }
+
+    if (schedulerSuspended > 1U)
+        {
+        schedulerSuspended--;
+        sei();
+        return;
+        }
+
+    /* Outermost - Stay suspended while replaying, so ticks and ISR wakes
+     * coming in between are held too and served in order */
+    while (pendingTicks != 0U)
+        {
+        pendingTicks--;
+        reschedule |= processTick();
+
+        /* Long replays - Let pending ISR in between ticks
+         * The instruction after sei always runs first, hence the nop */
+        sei();
+        __asm__ __volatile__ ("nop \n\t");
+        cli();
+        }
+
+    /* Nothing held any more - Resume within the same ISR off section */
+    schedulerSuspended = 0;
+
+    reschedule |= yieldPending;
+    yieldPending = 0;
+
+    sei();  /* Enable ISR */
+
+    if (reschedule != 0U)
+        {
+        wTaskYield();
+        }
+    }
+
+#if W_USE_STATS
+/* Clears execution time stats - NULL clears every task */
+IMPORT void wTaskStatsReset(wTask_t * task)
+    {
+    wTask_t * node = taskHead;
+    UINT8 sreg = SREG;
+
+    cli();
+    if (task != NULL)
+        {
+        (void) memset (&task->stats, 0, sizeof (wTaskStats_t));
+        }
+    else
+        {
+        while (node != NULL)
+            {
+            (void) memset (&node->stats, 0, sizeof (wTaskStats_t));
+            node = node->next;
+            }
+        (void) memset (&wIdleTask->stats, 0, sizeof (wTaskStats_t));
+        }
+
+    /* Running task restarts its segment now */
+    wCurrentTask->stats.segStart = statsTimeStamp();
+    SREG = sreg;
+    }
+
+/* Prints execution time stats over serial - NULL dumps every task */
+IMPORT void wTaskStatsDump(wTask_t * task)
+    {
+    wTask_t * node = taskHead;
+
+    if (task != NULL)
+        {
+        statsDump (task);
+        return;
+        }
+
+    while (node != NULL)
+        {
+        statsDump (node);
+        node = node->next;
+        }
+    statsDump (wIdleTask);
+    }
+#endif /* W_USE_STATS */
+
+/* Returns the number of ticks elapsed since the scheduler started */
+IMPORT UINT32 wTickGet(void)
+    {
+    UINT32 ticks = 0;
+    UINT8 sreg = SREG;
+
+    /* 32-bit read is not atomic on AVR */
+    cli();
+    ticks = wTickCount;
+    SREG = sreg;
+
+    return ticks;
+    }
 
 /*******************************************************************************
 * Private Tasks functions
@@ -194,6 +604,14 @@ LOCAL void wTaskYield(void)
     {
     cli();  /* Disable ISR */
 
+    /* Suspended - wSchedulerResume() does the switch */
+    if (schedulerSuspended != 0U)
+        {
+        yieldPending = 1;
+        sei();
+        return;
+        }
+
     /* Set counter just before compare match */
     TCNT2 = YIELD_ISR_TO_COMPARE - 1;
     
@@ -203,16 +621,219 @@ LOCAL void wTaskYield(void)
     sei();  /* Enable ISR */
     }
 
+/* Creates tasks - Called with ISR disabled */
+LOCAL wTask_t * createTask (const wTaskDesc_t * desc)
+    {
+    wTask_t * taskCtrl = NULL;
+    void * stack = NULL;
+
+    /* Sanity checks */
+    if (desc == NULL || pgm_read_word (&desc->taskFn) == 0U)
+        {
+        CRITICAL_LOG("Fail on wTaskCreate - Initial sanity checks");
+        return NULL;
+        }
+
+    /* Create task ctrl */
+    taskCtrl = (wTask_t *) kernelAlloc (sizeof (wTask_t));
+    if ( taskCtrl == NULL)
+        {
+        CRITICAL_LOG("Fail on wTaskCreate - Fail to allocate heap for task");
+        return NULL;
+        }
+    
+    taskCtrl->desc = desc;
+    taskCtrl->taskStatus = TASK_RUNNING;
+    taskCtrl->timeSlice = DEFAULT_TIME_SLICE;
+    taskCtrl->sliceLeft = DEFAULT_TIME_SLICE;
+
+    /* Zeroed by the allocator */
+    stack = kernelAlloc (pgm_read_word (&desc->stackSize));
+    if (stack == NULL)
+        {
+        CRITICAL_LOG("Fail on wTaskCreate - Fail to "
+                    "allocate heap for task stack");
+        kernelFree (taskCtrl);
+        return NULL;        
+        }
+    taskCtrl->stackPtr = stack;
+
+    /* Fill stack context */
+    fillStackContext(taskCtrl);
+
+    insertTask (taskCtrl);
+
+    return taskCtrl;
+    }
+
+#if W_USE_EDF
+/* Releases the next job of a periodic task - Called with ISR disabled */
+LOCAL void edfRelease (wTask_t * task)
+    {
+    UINT16 period = pgm_read_word (&task->desc->period);
+    UINT16 deadline = pgm_read_word (&task->desc->deadline);
+
+    if (deadline == 0U)
+        {
+        deadline = period;
+        }
+
+    task->absDeadline = task->nextRelease + deadline;
+    task->nextRelease += period;
+    task->jobMissed = 0;
+    task->taskStatus = TASK_RUNNING;
+
+    edfInsert (task);
+    }
+
+/* Release period of a task - 0 if not periodic */
+LOCAL UINT16 taskPeriod (wTask_t * task)
+    {
+    return pgm_read_word (&task->desc->period);
+    }
+
+/* Insert in the EDF list ordered by absolute deadline - FIFO on ties */
+LOCAL void edfInsert (wTask_t * task)
+    {
+    wTask_t * prev = NULL;
+    wTask_t * node = edfHead;
+
+    while (node != NULL &&
+           (int32_t)(node->absDeadline - task->absDeadline) <= 0)
+        {
+        prev = node;
+        node = node->edfNext;
+        }
+
+    task->edfNext = node;
+    if (prev == NULL)
+        {
+        edfHead = task;
+        }
+    else
+        {
+        prev->edfNext = task;
+        }
+    }
+
+/* Remove from the EDF list - Called with ISR disabled */
+LOCAL void edfRemove (wTask_t * task)
+    {
+    wTask_t * prev = NULL;
+    wTask_t * node = edfHead;
+
+    while (node != NULL && node != task)
+        {
+        prev = node;
+        node = node->edfNext;
+        }
+
+    if (node == NULL)
+        {
+        return; /* Not on the list */
+        }
+
+    if (prev == NULL)
+        {
+        edfHead = task->edfNext;
+        }
+    else
+        {
+        prev->edfNext = task->edfNext;
+        }
+    task->edfNext = NULL;
+    }
+#endif /* W_USE_EDF */
+
+#if !W_USE_HEAP
+/* Takes zeroed memory from the static arena - Called with ISR disabled */
+LOCAL void * kernelAlloc (UINT16 size)
+    {
+    void * block = NULL;
+
+    if (size > (W_KERNEL_ARENA_SIZE - kernelArenaUsed))
+        {
+        return NULL;
+        }
+
+    block = &kernelArena[kernelArenaUsed];
+    kernelArenaUsed += size;
+
+    return block;
+    }
+#endif /* !W_USE_HEAP */
+
+/* Counts a notification and wakes the task - Called with ISR disabled
+ * Returns 1 if the task was woken up */
+LOCAL UINT8 notifyTask (wTask_t * task)
+    {
+    if (task->notifyCount < 0xFF)
+        {
+        task->notifyCount++;
+        }
+
+    /* Object waits are only woken by their object */
+    if (task->taskStatus != TASK_BLOCKED || task->waitObj != NULL)
+        {
+        return 0;
+        }
+
+    task->taskStatus = TASK_RUNNING;
+    task->ticksToDelay = 0;
+
+    return 1;
+    }
+
+/* Wakes the task if it waits on obj - Called with ISR disabled
+ * Returns 1 if the task was woken up */
+LOCAL UINT8 wakeObjectTask (wTask_t * task, void * obj)
+    {
+    if (task->taskStatus != TASK_BLOCKED || task->waitObj != obj)
+        {
+        return 0;
+        }
+
+    task->waitObj = NULL;
+    task->taskStatus = TASK_RUNNING;
+    task->ticksToDelay = 0;
+
+    return 1;
+    }
+
+/* Asks for a switch on W_ISR exit if the task woken by an ISR has to run */
+LOCAL void isrWake (wTask_t * task)
+    {
+    /* Scheduler not started - No context to switch from, the count
+     * or wake-up is still recorded */
+    if (wCurrentTask == NULL || isrWakePreempts (task) == 0U)
+        {
+        return;
+        }
+
+    wakeHint = task;
+
+    /* Suspended - wSchedulerResume() does the switch */
+    if (schedulerSuspended != 0U)
+        {
+        yieldPending = 1;
+        }
+    else
+        {
+        wYieldFromISR = 1;
+        }
+    }
+
 /* Context filling routine */
 LOCAL void fillStackContext (wTask_t * taskCtrl)
     {
     /* taskCtrl already checked on call-tree */
 
     UINT8 *stack = (UINT8 *) taskCtrl->stackPtr;
-    UINT16 addr = (UINT16) taskCtrl->taskFn; /* entry point of task function */
+    /* entry point of task function */
+    UINT16 addr = pgm_read_word (&taskCtrl->desc->taskFn);
 
     /* Move stack pointer to top (stack grows down) */
-    stack += taskCtrl->stackSize;
+    stack += pgm_read_word (&taskCtrl->desc->stackSize);
 
     /* This is the SREG that `reti` will pop last */
     *(--stack) = 0x80; // SREG with I-bit (interrupts enabled)
@@ -243,65 +864,52 @@ LOCAL wTask_t * createMainTask (void)
     wTask_t * taskCtrl = NULL;
 
     /* Create TCB for main */
-    taskCtrl = (wTask_t *) calloc (1, sizeof (wTask_t));
+    taskCtrl = (wTask_t *) kernelAlloc (sizeof (wTask_t));
     if ( taskCtrl == NULL)
         {
         return NULL;
         }
     
-    (void) strcpy (taskCtrl->name, "main");
-    /* No need to setup the function ptr */
-    taskCtrl->stackSize = MINIMAL_STACK_SIZE;
+    /* Main keeps running on the C stack - Its SP is saved on 1st switch */
+    taskCtrl->desc = &mainTaskDesc;
     taskCtrl->taskStatus = TASK_RUNNING;
-    taskCtrl->stackPtr = (void *) malloc (MINIMAL_STACK_SIZE);
-    (void) memset (taskCtrl->stackPtr, 0, MINIMAL_STACK_SIZE);
+    taskCtrl->timeSlice = DEFAULT_TIME_SLICE;
+    taskCtrl->sliceLeft = DEFAULT_TIME_SLICE;
 
-    if (insertTaskNode (taskCtrl) != OK)
-        {
-        CRITICAL_LOG ("Fail adding main task to the list");
-        return NULL;
-        }
+    insertTask (taskCtrl);
     
     return taskCtrl;
     }
 
 /* Idle task create - Is not added to the task list */
-LOCAL wTask_t * createIdleTask (wTaskHandler taskFn, UINT16 stackSize)
+LOCAL wTask_t * createIdleTask (void)
     {
     wTask_t * taskCtrl = NULL;
     
     /* Disable ISR */
     cli();
 
-    /* Sanity checks */
-    if (taskFn == NULL)
-        {
-        CRITICAL_LOG("Fail creating Idle task - taskFn is NULL");
-        return NULL;
-        }
-
     /* Create task ctrl */
-    taskCtrl = (wTask_t *) calloc (1, sizeof (wTask_t));
+    taskCtrl = (wTask_t *) kernelAlloc (sizeof (wTask_t));
     if ( taskCtrl == NULL)
         {
         CRITICAL_LOG("Fail creating Idle task - Fail allocating TCB");
+        sei();
         return NULL;
         }
     
-    (void) strcpy (taskCtrl->name, "idle");
-    taskCtrl->taskFn = taskFn;
-    taskCtrl->stackSize = stackSize;
+    taskCtrl->desc = &idleTaskDesc;
     taskCtrl->taskStatus = TASK_RUNNING;
 
-    taskCtrl->stackPtr = (void *) malloc (stackSize);
+    taskCtrl->stackPtr = kernelAlloc (IDLE_TASK_STACK);
     if (taskCtrl->stackPtr == NULL)
         {
         CRITICAL_LOG("Fail creating Idle task - Fail to "
                     "allocate heap for task stack");
-        free (taskCtrl);
+        kernelFree (taskCtrl);
+        sei();
         return NULL;        
         }
-    (void) memset (taskCtrl->stackPtr, 0, stackSize);
 
     /* Fill stack context */
     fillStackContext(taskCtrl);
@@ -314,39 +922,29 @@ LOCAL wTask_t * createIdleTask (wTaskHandler taskFn, UINT16 stackSize)
     return taskCtrl;    
     }
 
-/* Insert a task node at the end of the list */
-LOCAL STATUS insertTaskNode (wTask_t * taskCtrl)
+/* Insert a task at the end of the list */
+LOCAL void insertTask (wTask_t * taskCtrl)
     {
-    wTaskNode_t * taskNode = NULL;
-    wTaskNode_t * currentNode = NULL;
+    wTask_t * currentTask = NULL;
 
-    taskNode = (wTaskNode_t *) calloc (1, sizeof(wTaskNode_t));
-    if (taskNode == NULL)
-        {
-        return ERROR;
-        }
-    
     /* taskCtrl was verified in the call-tree */
-    taskNode->task = taskCtrl;
-    taskNode->next = NULL;
+    taskCtrl->next = NULL;
 
-     
-    if (taskHeadNode == NULL)
+    if (taskHead == NULL)
         {
-        /* First node in the list */
-        taskHeadNode = taskNode;
-        return OK;
+        /* First task in the list */
+        taskHead = taskCtrl;
+        return;
         }
 
     /* Inserts in the end of the SLL */
-    currentNode = taskHeadNode;
-    while (currentNode->next != NULL)
+    currentTask = taskHead;
+    while (currentTask->next != NULL)
         {
-        currentNode = currentNode->next;
+        currentTask = currentTask->next;
         }
 
-    currentNode->next = taskNode;
-    return OK;
+    currentTask->next = taskCtrl;
     }
 
 /* Idle Task - Default task for the scheduler - Has to be always RUNNING */
@@ -363,22 +961,43 @@ LOCAL void idleTask (void)
 * Tick and Context Saving/Restoring Management
 */
 
-/* Tick management routine - Decrements ticks from STOPPED tasks */
-void wTickManagment (void)
+/* Tick management routine - Called from the tick ISR
+ * Returns 1 if the running task has to be switched out */
+UINT8 wTickManagment (void)
     {
-    wTaskNode_t * node = taskHeadNode;
+    /* Suspended - Keep the tick for wSchedulerResume() */
+    if (schedulerSuspended != 0U)
+        {
+        if (pendingTicks < 0xFFFF)
+            {
+            pendingTicks++;
+            }
+        return 0;
+        }
+
+    return processTick();
+    }
+
+/* Tick processing - Decrements ticks from STOPPED tasks
+ * Returns 1 if the running task has to be switched out */
+LOCAL UINT8 processTick (void)
+    {
+    wTask_t * task = taskHead;
+    UINT8 reschedule = 0;
+    UINT8 othersReady = 0;
+
+    wTickCount++;
 
     /* Iterate each task */
-    while (node != NULL)
+    while (task != NULL)
         {
-        wTask_t * task = node->task;
-
-        if (task->taskStatus == TASK_STOPPED && task->ticksToDelay >= 0)
+        if (task->taskStatus == TASK_STOPPED)
             {
             if (task->ticksToDelay == 0)
                 {
                 /* Mark the task as RUNNING */
                 task->taskStatus = TASK_RUNNING;
+                reschedule |= preemptsCurrent (task);
                 }
             else
                 {
@@ -387,56 +1006,326 @@ void wTickManagment (void)
                 }
                 
             }
-        node = node->next;
+        else if (task->taskStatus == TASK_BLOCKED &&
+                 task->ticksToDelay != 0U)
+            {
+            if (--task->ticksToDelay == 0U)
+                {
+                /* Notification wait timed out */
+                task->taskStatus = TASK_RUNNING;
+                reschedule |= preemptsCurrent (task);
+                }
+            }
+#if W_USE_EDF
+        else if (task->taskStatus == TASK_PERIOD_WAIT)
+            {
+            if ((int32_t)(wTickCount - task->nextRelease) >= 0)
+                {
+                /* Release the next job */
+                edfRelease (task);
+                reschedule |= preemptsCurrent (task);
+                }
+            }
+
+        /* Job still pending past its deadline */
+        if (task->taskStatus != TASK_PERIOD_WAIT &&
+            taskPeriod (task) != 0U &&
+            task->jobMissed == 0U &&
+            (int32_t)(wTickCount - task->absDeadline) > 0)
+            {
+            task->jobMissed = 1;
+            task->deadlineMisses++;
+
+            if (edfOverrunHook != NULL)
+                {
+                edfOverrunHook (task);
+                }
+            }
+#endif /* W_USE_EDF */
+
+        /* Someone to hand a finished slice to */
+        if (task != wCurrentTask && task->taskStatus == TASK_RUNNING)
+            {
+            othersReady = 1;
+            }
+        task = task->next;
+        }
+
+#if W_USE_EDF
+    /* The switcher picks a running job again - Its slice never ends */
+    if (taskPeriod (wCurrentTask) != 0U)
+        {
+        othersReady = 0;
+        }
+#endif /* W_USE_EDF */
+
+    /* A plain ISR woke a task that has to run */
+    reschedule |= wYieldFromISR;
+
+    /* Running task blocked - Its yield is still pending */
+    if (wCurrentTask->taskStatus != TASK_RUNNING)
+        {
+        reschedule = 1;
+        }
+    /* Running task is out of its time slice - 0 is cooperative */
+    else if (wCurrentTask->timeSlice != 0U &&
+             --wCurrentTask->sliceLeft == 0U)
+        {
+        if (othersReady != 0U)
+            {
+            reschedule = 1;
+            }
+        else
+            {
+            /* Nobody else to run - Skip the switch, start a new slice */
+            wCurrentTask->sliceLeft = wCurrentTask->timeSlice;
+            }
+        }
+
+    return reschedule;
+    }
+
+/* Checks if a task made ready has to preempt the running one */
+LOCAL UINT8 preemptsCurrent (wTask_t * task)
+    {
+    if (wCurrentTask == wIdleTask)
+        {
+        return 1;
+        }
+
+#if W_USE_EDF
+    /* Periodic jobs go before other tasks and by earliest deadline */
+    if (taskPeriod (task) != 0U &&
+        (taskPeriod (wCurrentTask) == 0U ||
+         (int32_t)(task->absDeadline - wCurrentTask->absDeadline) < 0))
+        {
+        return 1;
+        }
+#endif /* W_USE_EDF */
+
+    return 0;
+    }
+
+/* Checks if a task woken by an ISR has to run on ISR exit
+ * Deferred interrupt work goes before round-robin tasks */
+LOCAL UINT8 isrWakePreempts (wTask_t * task)
+    {
+#if W_USE_EDF
+    if (taskPeriod (wCurrentTask) != 0U)
+        {
+        return preemptsCurrent (task);
         }
+#endif /* W_USE_EDF */
 
+    return task != wCurrentTask;
     }
 
-/* Task Switcher - Routine goes through the task list */
+/* Task Switcher - Picks the next task and accounts the run segment */
 void wtaskSwitcher (void)
+    {
+#if W_USE_STATS
+    wTask_t * prevTask = wCurrentTask;
+    UINT32 now = 0;
+#endif /* W_USE_STATS */
+
+    selectNextTask();
+    wYieldFromISR = 0;
+
+    /* Fresh time slice for the task switched in */
+    wCurrentTask->sliceLeft = wCurrentTask->timeSlice;
+
+#if W_USE_STATS
+    if (wCurrentTask != prevTask)
+        {
+        now = statsTimeStamp();
+        statsRecord (&prevTask->stats, now - prevTask->stats.segStart);
+        wCurrentTask->stats.segStart = now;
+        }
+#endif /* W_USE_STATS */
+    }
+
+/* Select next task - Routine goes through the task list */
+LOCAL void selectNextTask (void)
     {    
-    static wTaskNode_t * currentNode = NULL;
-    wTaskNode_t * startNode = NULL;
+    static wTask_t * currentNode = NULL;
+    wTask_t * startNode = NULL;
+
+#if W_USE_EDF
+    wTask_t * edfTask = edfHead;
+
+    /* Released jobs go first - earliest deadline that is not delayed */
+    while (edfTask != NULL)
+        {
+        if (edfTask->taskStatus == TASK_RUNNING)
+            {
+            wCurrentTask = edfTask;
+            return;
+            }
+        edfTask = edfTask->edfNext;
+        }
+#endif /* W_USE_EDF */
+
+    /* Task woken by an ISR runs next */
+    if (wakeHint != NULL)
+        {
+        wTask_t * hint = wakeHint;
+
+        wakeHint = NULL;
+        if (hint->taskStatus == TASK_RUNNING)
+            {
+            wCurrentTask = hint;
+            return;
+            }
+        }
 
     /* Point to the head node as the main task is the 1st to run */
     if (currentNode == NULL)
         {
-        currentNode = taskHeadNode;
+        currentNode = taskHead;
         }
 
     /* Start from next task in round-robin order */
     currentNode = (currentNode->next != NULL) ? 
-                currentNode->next : taskHeadNode;
+                currentNode->next : taskHead;
     
     startNode = currentNode;  // Remember where we started
 
     do 
     {
-        wTask_t * task = currentNode->task;
-        if (task->taskStatus == TASK_RUNNING)
+        if (currentNode->taskStatus == TASK_RUNNING)
             {
-            wCurrentTask = task;
+            wCurrentTask = currentNode;
             return;
             }
 
         currentNode = 
-                (currentNode->next != NULL) ? currentNode->next : taskHeadNode;
+                (currentNode->next != NULL) ? currentNode->next : taskHead;
     } while (currentNode != startNode);  /* Stop if it looped around */
 
     /* No RUNNING task found — fallback to idle or first task */
     wCurrentTask = wIdleTask;
     }
 
+#if W_USE_STATS
+/* Sub-tick time stamp in timer 1 counts - Called with ISR disabled */
+LOCAL UINT32 statsTimeStamp (void)
+    {
+    UINT32 ticks = wTickCount;
+    UINT16 count = TCNT1;
+
+    /* Counter wrapped but the tick ISR did not run yet */
+    if (TIFR1 & (1 << OCF1A))
+        {
+        count = TCNT1;
+        ticks++;
+        }
+
+    return ticks * (TICK_ISR_TO_COMPARE + 1UL) + count;
+    }
+
+/* Adds a run segment to the task stats */
+LOCAL void statsRecord (wTaskStats_t * stats, UINT32 segment)
+    {
+    UINT8 bucket = 0;
+    UINT32 range = segment >> (STATS_BUCKET_SHIFT + 1);
+
+    /* log2 bucket - Last bucket takes everything above */
+    while (range != 0 && bucket < (STATS_BUCKETS - 1))
+        {
+        range >>= 1;
+        bucket++;
+        }
+
+    if (stats->hist[bucket] < 0xFFFF)
+        {
+        stats->hist[bucket]++;
+        }
+
+    if (stats->segments == 0 || segment < stats->minTime)
+        {
+        stats->minTime = segment;
+        }
+    if (segment > stats->maxTime)
+        {
+        stats->maxTime = segment;
+        }
+
+    stats->totalTime += segment;
+    stats->segments++;
+    }
+
+/* Prints the stats of one task */
+LOCAL void statsDump (wTask_t * task)
+    {
+    wTaskStats_t stats;
+    UINT32 mean = 0;
+    PGM_P name = (PGM_P) pgm_read_word (&task->desc->name);
+    char nameBuf [12] = "";
+    UINT8 sreg = SREG;
+
+    /* Snapshot - The switcher updates the stats from ISR */
+    cli();
+    stats = task->stats;
+    SREG = sreg;
+
+    if (stats.segments != 0)
+        {
+        mean = (UINT32)(stats.totalTime / stats.segments);
+        }
+
+    if (name != NULL)
+        {
+        (void) strncpy_P (nameBuf, name, sizeof (nameBuf) - 1);
+        printf ("%-11s", nameBuf);
+        }
+    else
+        {
+        printf ("0x%04X     ", (unsigned) task);
+        }
+    printf (" n=%lu min=%luus max=%luus mean=%luus\n",
+            (unsigned long) stats.segments,
+            (unsigned long) STATS_COUNTS_TO_US(stats.minTime),
+            (unsigned long) STATS_COUNTS_TO_US(stats.maxTime),
+            (unsigned long) STATS_COUNTS_TO_US(mean));
+
+    /* Bucket i holds segments of [2^(i+shift), 2^(i+shift+1)) timer
+     * counts - Bucket 0 also holds the shorter ones */
+    printf ("  hist (bucket i from 2^(i+%u) counts):", STATS_BUCKET_SHIFT);
+    for (UINT8 i = 0; i < STATS_BUCKETS; i++)
+        {
+        printf (" %u", stats.hist[i]);
+        }
+    printf ("\n");
+    }
+#endif /* W_USE_STATS */
+
 /* Disable Timer 2 aux routine */
 void disableTimer2 (void)
     {
     TIMSK2 &= ~(1 << OCIE2A);
     }
 
-/* Tick ISR */
+/* Tick ISR - Full context switch only when tick management asks for it */
 void TIMER1_COMPA_vect (void)
     {
 
+    __asm__ __volatile__ (
+        W_ISR_SAVE_CLOBBERED
+
+        /* Call Tick Management - Returns r24 != 0 to switch */
+        "rcall wTickManagment       \n\t"
+        "tst  r24                   \n\t"
+
+        W_ISR_RESTORE_CLOBBERED
+        W_ISR_LEAVE
+        );
+    }
+
+/* Full context switch - Entered by jmp from an ISR prologue with every
+ * register back to its value on ISR entry */
+void wIsrContextSwitch (void)
+    {
+
     __asm__ __volatile__ (
         /* --- Save Context --- */
         "push r0                \n\t"              
@@ -462,9 +1351,6 @@ void TIMER1_COMPA_vect (void)
         "in   r0, __SP_H__          \n\t"
         "st   x+, r0                \n\t"
 
-        /* Call Tick Management */
-        "rcall wTickManagment       \n\t"
-
         /* Call task switcher */
         "rcall wtaskSwitcher        \n\t"
 
@@ -523,9 +1409,6 @@ void TIMER2_COMPA_vect (void)
 
         /* Disable Timer2 */
         "rcall disableTimer2        \n\t"
-        
-        /* Call Tick Management */
-        "rcall wTickManagment       \n\t"
 
         /* Call task switcher */
         "rcall wtaskSwitcher        \n\t"
@@ -556,7 +1439,7 @@ void TIMER2_COMPA_vect (void)
 
 /*******************************************************************************
 * Timer Setup for tick counter 
-* 10 ms tick period
+* TICK_MS tick period
 * OCR1A = (Fcpu.tick)/prescaler - 1 
 */
 
@@ -575,7 +1458,7 @@ LOCAL void timerSetup (void)
     sei();
     }
 
-/* Timer for tick - 10 ms period */
+/* Timer for tick - TICK_MS period */
 LOCAL void timer1Setup (void)
     {
     /* Reset registers */
@@ -583,10 +1466,10 @@ LOCAL void timer1Setup (void)
     TCCR1B = 0;
     TCNT1  = 0;
 
-    /* Set Prescaler (64) and CTC mode */
-    TCCR1B |= (1 << WGM12) | (1 << CS11) | (1 << CS10);
+    /* Set Prescaler (derived from F_CPU in uWireConfig.h) and CTC mode */
+    TCCR1B |= (1 << WGM12) | TICK_TIMER_CS;
 
-    /* Set value to compare: (16 MHz . 10 ms) / 64 - 1 = 2499 -HEX-> 0x09C3 */
+    /* Set value to compare: F_CPU / (prescaler . W_TICK_HZ) - 1 */
     OCR1A = TICK_ISR_TO_COMPARE;
 
     /* Set the bit 2 of TIMSK1 - Compare Interrupt Enable */
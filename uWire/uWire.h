@@ -7,58 +7,202 @@
 #include <avr/io.h>
 #include <util/delay.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include "common.h"
+#include "uWireConfig.h"
 #include "uWire.h"
 
-#define TICK_MS    10           /* 1 tick = 10 milliseconds */
-#define MINIMAL_STACK_SIZE 256  /* Minimal stack size */
-#define IDLE_TASK_STACK 128     /* Stack size for idle */
-
-/* Set value to compare: (16 MHz . 10 ms) / 64 - 1 = 2499 -HEX-> 0x09C3 */
-#define TICK_ISR_TO_COMPARE 0x09C3
-
-/* Yield compare value */
-#define YIELD_ISR_TO_COMPARE 0xFA
+/* Timer 1 counts to microseconds */
+#define STATS_COUNTS_TO_US(c) \
+    ((c) * (UINT32) TICK_TIMER_PRESCALER / (F_CPU / 1000000UL))
 
 /* typedefs */
 
 /* Task Function pointer */
 typedef void (* wTaskHandler) ();
 
-/* Task Status enum */
+/* Task Descriptor - Constant task data, lives in flash (PROGMEM) */
+typedef struct taskDesc
+    {
+    wTaskHandler taskFn;            /* Task routine */
+    const char * name;              /* Task Name - PROGMEM string */
+    UINT16 stackSize;               /* Task Stack Size */
+#if W_USE_EDF
+    UINT16 period;                  /* Release period in ticks - 0 if none */
+    UINT16 deadline;                /* Relative deadline in ticks */
+#endif /* W_USE_EDF */
+    } wTaskDesc_t;
+
+/* Declares a task descriptor in flash - Pass &desc to wTaskCreate() */
+#if W_USE_NAMES
+#define W_TASK_DESC(desc, fn, taskName, stack)                      \
+    LOCAL const char desc##Name [] PROGMEM = taskName;              \
+    LOCAL const wTaskDesc_t desc PROGMEM =                          \
+        { .taskFn = (fn), .name = desc##Name, .stackSize = (stack) }
+#else
+#define W_TASK_DESC(desc, fn, taskName, stack)                      \
+    LOCAL const wTaskDesc_t desc PROGMEM =                          \
+        { .taskFn = (fn), .name = NULL, .stackSize = (stack) }
+#endif /* W_USE_NAMES */
+
+#if W_USE_EDF
+/* Periodic task descriptor - deadline 0 means deadline = period */
+#if W_USE_NAMES
+#define W_PERIODIC_TASK_DESC(desc, fn, taskName, stack, per, dl)    \
+    LOCAL const char desc##Name [] PROGMEM = taskName;              \
+    LOCAL const wTaskDesc_t desc PROGMEM =                          \
+        { .taskFn = (fn), .name = desc##Name, .stackSize = (stack), \
+          .period = (per), .deadline = (dl) }
+#else
+#define W_PERIODIC_TASK_DESC(desc, fn, taskName, stack, per, dl)    \
+    LOCAL const wTaskDesc_t desc PROGMEM =                          \
+        { .taskFn = (fn), .name = NULL, .stackSize = (stack),       \
+          .period = (per), .deadline = (dl) }
+#endif /* W_USE_NAMES */
+#endif /* W_USE_EDF */
+
+/* Task Status enum - Stored as UINT8 in the TCB */
 typedef enum
     {
     TASK_RUNNING,
     TASK_STOPPED,
+    TASK_PERIOD_WAIT,               /* Periodic task waiting for release */
+    TASK_BLOCKED,                   /* Waiting for a notification */
     TASK_STATUS_END_ENUM
     } wTaskStatus_t;
 
-/* Task Control Block */
-typedef struct task
+/* Task execution time stats - Times in timer 1 counts */
+typedef struct taskStats
+    {
+    UINT32 segStart;                /* Time stamp of the last switch-in */
+    UINT32 minTime;                 /* Shortest run segment */
+    UINT32 maxTime;                 /* Longest run segment */
+    UINT64 totalTime;               /* Sum of run segments - For the mean */
+    UINT32 segments;                /* Number of run segments */
+    UINT16 hist [STATS_BUCKETS];    /* log2 histogram of run segments */
+    } wTaskStats_t;
+
+/* Task Control Block - Packed, constant data is on the descriptor */
+typedef struct __attribute__ ((packed)) task
     {
     void * stackPtr;                /* HAS TO BE 1st! Task Stack pointer */
-    UINT16 stackSize;               /* Task Stack Size*/
-    char name [12];                 /* Task Name */
-    wTaskHandler taskFn;            /* Task routine */
-    wTaskStatus_t taskStatus;       /* Task Status */
-    UINT64 ticksToDelay;            /* Ticks to Pend the Task */
+    const wTaskDesc_t * desc;       /* Task Descriptor - PROGMEM */
+    struct task * next;             /* Next task on the task list */
+    UINT8 taskStatus;               /* Task Status - wTaskStatus_t */
+    UINT8 timeSlice;                /* Slice in ticks - 0 is cooperative */
+    UINT8 sliceLeft;                /* Ticks left on the current slice */
+    UINT16 ticksToDelay;            /* Ticks to Pend the Task */
+    UINT8 notifyCount;              /* Notifications not yet taken */
+    void * waitObj;                 /* Object waited on - Waker clears it */
+#if W_USE_EDF
+    UINT32 nextRelease;             /* Tick of the next job release */
+    UINT32 absDeadline;             /* Tick deadline of the current job */
+    UINT16 deadlineMisses;          /* Jobs that missed their deadline */
+    UINT8 jobMissed;                /* Current job already counted */
+    struct task * edfNext;          /* Next task on the EDF list */
+#endif /* W_USE_EDF */
+#if W_USE_STATS
+    wTaskStats_t stats;             /* Execution time stats */
+#endif /* W_USE_STATS */
     } wTask_t;
 
-/* Task Node for task list */
-typedef struct taskNode
-    {
-    wTask_t * task;
-    struct taskNode * next;
-    } wTaskNode_t;
+/* Deadline miss hook - Runs on the tick ISR */
+typedef void (* wOverrunHook) (wTask_t * task);
+
+/*******************************************************************************
+* ISR wrapper
+*
+* W_ISR(vector) declares an interrupt handler that may wake tasks with the
+* FromISR calls. If a woken task has to run, the switch happens on ISR exit
+* instead of on the next tick. The body runs with ISR disabled.
+*
+*   W_ISR (INT0_vect)
+*       {
+*       wTaskNotifyFromISR (buttonTask);
+*       }
+*/
+
+#define W_WAIT_FOREVER 0        /* No timeout for wTaskNotifyWait() */
+
+#define W_ISR_STR_(x) #x
+#define W_ISR_STR(x) W_ISR_STR_(x)
+
+/* Save the registers a C call can clobber */
+#define W_ISR_SAVE_CLOBBERED                                        \
+        "push r0                    \n\t"                           \
+        "in   r0, __SREG__          \n\t"                           \
+        "push r0                    \n\t"                           \
+        "push r1                    \n\t"                           \
+        "clr  r1                    \n\t"                           \
+        "push r18\n\t push r19\n\t push r20\n\t push r21\n\t"         \
+        "push r22\n\t push r23\n\t push r24\n\t push r25\n\t"         \
+        "push r26\n\t push r27\n\t push r30\n\t push r31\n\t"
+
+/* Restore them - pop keeps the SREG flags */
+#define W_ISR_RESTORE_CLOBBERED                                     \
+        "pop r31\n\t pop r30\n\t pop r27\n\t pop r26\n\t"             \
+        "pop r25\n\t pop r24\n\t pop r23\n\t pop r22\n\t"             \
+        "pop r21\n\t pop r20\n\t pop r19\n\t pop r18\n\t"             \
+        "pop r1                     \n\t"
+
+/* Leave the ISR - Z flag clear means switch tasks on the way out */
+#define W_ISR_LEAVE                                                 \
+        "brne 1f                    \n\t"                           \
+        "pop  r0                    \n\t"                           \
+        "out  __SREG__, r0          \n\t"                           \
+        "pop  r0                    \n\t"                           \
+        "reti                       \n\t"                           \
+        "1:                         \n\t"                           \
+        "pop  r0                    \n\t"                           \
+        "out  __SREG__, r0          \n\t"                           \
+        "pop  r0                    \n\t"                           \
+        "jmp  wIsrContextSwitch     \n\t"
+
+#define W_ISR(vector)                                               \
+    void vector##_body (void);                                      \
+    void vector (void) __attribute__ ((signal, naked, used));       \
+    void vector (void)                                              \
+        {                                                           \
+        __asm__ __volatile__ (                                      \
+            W_ISR_SAVE_CLOBBERED                                    \
+            "call " W_ISR_STR (vector##_body) "\n\t"                \
+            "lds  r24, wYieldFromISR    \n\t"                       \
+            "sts  wYieldFromISR, r1     \n\t"                       \
+            "tst  r24                   \n\t"                       \
+            W_ISR_RESTORE_CLOBBERED                                 \
+            W_ISR_LEAVE                                             \
+            );                                                      \
+        }                                                           \
+    void vector##_body (void)
+
+IMPORT volatile UINT8 wYieldFromISR; /* Switch tasks on W_ISR exit */
 
 /* Forward section */
 
 IMPORT void initScheduler(void);
-IMPORT wTask_t * wTaskCreate(wTaskHandler taskFn,
-                            const char name[12],
-                            UINT16 stackSize);
+IMPORT wTask_t * wTaskCreate(const wTaskDesc_t * desc);
 IMPORT void hexDumpStack(wTask_t *task);
-IMPORT STATUS wTaskDelay(UINT64 ticks);
+IMPORT STATUS wTaskDelay(UINT16 ticks);
+#if W_USE_NAMES
 IMPORT wTask_t * acquireTaskByName(const char * taskName);
+#endif /* W_USE_NAMES */
+IMPORT UINT32 wTickGet(void);
+IMPORT STATUS wTaskSetTimeSlice(wTask_t * task, UINT8 ticks);
+IMPORT STATUS wTaskNotifyWait(UINT16 timeout);
+IMPORT STATUS wTaskNotify(wTask_t * task);
+IMPORT void wTaskNotifyFromISR(wTask_t * task);
+IMPORT STATUS wTaskWaitObject(void * obj, UINT16 timeout);
+IMPORT void wTaskWakeObject(void * obj);
+IMPORT void wTaskWakeObjectFromISR(void * obj);
+IMPORT void wSchedulerSuspend(void);
+IMPORT void wSchedulerResume(void);
+#if W_USE_EDF
+IMPORT STATUS wTaskWaitNextPeriod(void);
+IMPORT void wTaskSetOverrunHook(wOverrunHook hook);
+#endif /* W_USE_EDF */
+#if W_USE_STATS
+IMPORT void wTaskStatsReset(wTask_t * task);
+IMPORT void wTaskStatsDump(wTask_t * task);
+#endif /* W_USE_STATS */
 
 #endif /* UWIRE_H */
\ No newline at end of file
@@ -0,0 +1,153 @@
+/* uWireConfig.h */
+
+#ifndef UWIRE_CONFIG_H
+#define UWIRE_CONFIG_H
+
+#include <avr/io.h>
+#include "uWireConfig.h"
+
+/*
+
+uWire compile-time configuration.
+
+Every option can be overridden from the compiler command line
+(e.g. CFLAGS += -DW_TICK_HZ=1000 -DW_USE_STATS=1).
+Timer constants are derived from F_CPU and W_TICK_HZ.
+
+*/
+
+#ifndef F_CPU
+#error "F_CPU must be defined"
+#endif
+
+/*******************************************************************************
+* Tick
+*/
+
+/* Tick rate in Hz */
+#ifndef W_TICK_HZ
+#define W_TICK_HZ 100
+#endif
+
+#define TICK_MS (1000 / W_TICK_HZ)  /* Tick period in milliseconds */
+
+/* Timer 1 prescaler - Smallest one that fits the 16-bit compare register */
+#if (F_CPU / W_TICK_HZ) <= 0x10000UL
+#define TICK_TIMER_PRESCALER 1
+#define TICK_TIMER_CS ((1 << CS10))
+#elif (F_CPU / (8UL * W_TICK_HZ)) <= 0x10000UL
+#define TICK_TIMER_PRESCALER 8
+#define TICK_TIMER_CS ((1 << CS11))
+#elif (F_CPU / (64UL * W_TICK_HZ)) <= 0x10000UL
+#define TICK_TIMER_PRESCALER 64
+#define TICK_TIMER_CS ((1 << CS11) | (1 << CS10))
+#elif (F_CPU / (256UL * W_TICK_HZ)) <= 0x10000UL
+#define TICK_TIMER_PRESCALER 256
+#define TICK_TIMER_CS ((1 << CS12))
+#else
+#define TICK_TIMER_PRESCALER 1024
+#define TICK_TIMER_CS ((1 << CS12) | (1 << CS10))
+#endif
+
+/* OCR1A = F_CPU / (prescaler . tick rate) - 1 */
+#define TICK_ISR_TO_COMPARE \
+    (F_CPU / ((unsigned long) TICK_TIMER_PRESCALER * W_TICK_HZ) - 1UL)
+
+/* Yield compare value - Timer 2 prescaler 64 */
+#define YIELD_ISR_TO_COMPARE 0xFA
+
+/*******************************************************************************
+* Tasks
+*/
+
+#ifndef MINIMAL_STACK_SIZE
+#define MINIMAL_STACK_SIZE 256  /* Minimal stack size */
+#endif
+
+#ifndef IDLE_TASK_STACK
+#define IDLE_TASK_STACK 128     /* Stack size for idle */
+#endif
+
+#ifndef DEFAULT_TIME_SLICE
+#define DEFAULT_TIME_SLICE 1    /* Ticks before a task is preempted */
+#endif
+
+/* Saved context: r0-r31, SREG and the return address */
+#define CONTEXT_SIZE 35
+
+/*******************************************************************************
+* Optional subsystems - 1 to enable, 0 to compile out
+*/
+
+/* Task name storage and acquireTaskByName() */
+#ifndef W_USE_NAMES
+#define W_USE_NAMES 1
+#endif
+
+/* Earliest deadline first for periodic tasks */
+#ifndef W_USE_EDF
+#define W_USE_EDF 0
+#endif
+
+/* Per task execution time stats */
+#ifndef W_USE_STATS
+#define W_USE_STATS 0
+#endif
+
+#define STATS_BUCKETS 12        /* log2 histogram buckets */
+
+/* Timer 1 counts per tick */
+#define STATS_TICK_COUNTS (F_CPU / (TICK_TIMER_PRESCALER * W_TICK_HZ))
+
+/* Histogram scale - Counts are shifted so the last bucket starts at one
+ * tick or above, whatever the timer 1 prescaler */
+#if STATS_TICK_COUNTS <= (1UL << (STATS_BUCKETS - 1))
+#define STATS_BUCKET_SHIFT 0
+#elif STATS_TICK_COUNTS <= (1UL << STATS_BUCKETS)
+#define STATS_BUCKET_SHIFT 1
+#elif STATS_TICK_COUNTS <= (1UL << (STATS_BUCKETS + 1))
+#define STATS_BUCKET_SHIFT 2
+#elif STATS_TICK_COUNTS <= (1UL << (STATS_BUCKETS + 2))
+#define STATS_BUCKET_SHIFT 3
+#elif STATS_TICK_COUNTS <= (1UL << (STATS_BUCKETS + 3))
+#define STATS_BUCKET_SHIFT 4
+#else
+#define STATS_BUCKET_SHIFT 5    /* Timer 1 holds at most 2^16 counts */
+#endif
+
+/* Kernel objects from malloc - 0 takes them from a static arena */
+#ifndef W_USE_HEAP
+#define W_USE_HEAP 1
+#endif
+
+/* Static arena for TCBs, task nodes and stacks when W_USE_HEAP is 0 */
+#ifndef W_KERNEL_ARENA_SIZE
+#define W_KERNEL_ARENA_SIZE 1024
+#endif
+
+/*******************************************************************************
+* Sanity checks
+*/
+
+_Static_assert (W_TICK_HZ > 0 && W_TICK_HZ <= 1000,
+                "W_TICK_HZ must be within 1..1000");
+_Static_assert (1000 % W_TICK_HZ == 0,
+                "W_TICK_HZ must give a whole number of milliseconds");
+_Static_assert (TICK_ISR_TO_COMPARE <= 0xFFFFUL,
+                "W_TICK_HZ too low for F_CPU - Timer 1 can not reach it");
+_Static_assert (TICK_ISR_TO_COMPARE >= 0xFFUL,
+                "W_TICK_HZ too high for F_CPU - Tick ISR would starve tasks");
+_Static_assert (F_CPU % ((unsigned long) TICK_TIMER_PRESCALER * W_TICK_HZ) == 0,
+                "F_CPU and W_TICK_HZ do not give an exact tick period");
+_Static_assert (IDLE_TASK_STACK > CONTEXT_SIZE &&
+                MINIMAL_STACK_SIZE > CONTEXT_SIZE,
+                "Stack sizes must hold at least one saved context");
+_Static_assert (W_USE_HEAP ||
+                W_KERNEL_ARENA_SIZE > IDLE_TASK_STACK + MINIMAL_STACK_SIZE,
+                "W_KERNEL_ARENA_SIZE can not hold the idle and main tasks");
+#if W_USE_STATS
+_Static_assert ((F_CPU / 1000000UL) * 1000000UL == F_CPU,
+                "W_USE_STATS needs F_CPU in whole MHz");
+#endif
+
+#endif /* UWIRE_CONFIG_H */
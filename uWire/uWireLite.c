@@ -0,0 +1,245 @@
+/* uWireLite.c */
+/*
+
+Lite task lib.
+- Runs stackless lite tasks inside one host task
+- Lite events
+
+*/
+#include <stdio.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "common.h"
+#include "uWire.h"
+#include "uWireLite.h"
+#include "log.h"
+
+/* Forward section */
+LOCAL void liteHostTask (void);
+LOCAL void unlinkLiteTask (wLiteTask_t * prev, wLiteTask_t * lt);
+LOCAL void eventCount (wLiteEvent_t * ev);
+
+/* Globals */
+
+LOCAL wLiteTask_t * volatile liteHead = NULL; /* List of lite tasks */
+LOCAL wTask_t * liteHost = NULL;              /* Host task for lite tasks */
+
+W_TASK_DESC (liteHostDesc, &liteHostTask, "liteHost", LITE_HOST_STACK);
+
+/*******************************************************************************
+* API Lite Tasks functions
+*/
+
+/* Creates the host task - All lite tasks share its stack */
+IMPORT wTask_t * wLiteHostCreate(void)
+    {
+    if (liteHost != NULL)
+        {
+        CRITICAL_LOG ("Fail on wLiteHostCreate - Host already created");
+        return NULL;
+        }
+
+    liteHost = wTaskCreate (&liteHostDesc);
+
+    return liteHost;
+    }
+
+/* Adds a lite task to the host - lt storage is owned by the caller */
+IMPORT STATUS wLiteTaskStart(wLiteTask_t * lt,
+                            wLiteHandler liteFn,
+                            void * arg)
+    {
+    wLiteTask_t * node = NULL;
+    UINT8 sreg = 0;
+
+    /* Sanity checks */
+    if (lt == NULL || liteFn == NULL)
+        {
+        CRITICAL_LOG ("Fail on wLiteTaskStart - Initial sanity checks");
+        return ERROR;
+        }
+
+    lt->lc = 0;
+    lt->wakeTick = 0;
+    lt->liteFn = liteFn;
+    lt->arg = arg;
+    lt->next = NULL;
+
+    /* Host may be walking the list */
+    sreg = SREG;
+    cli();
+
+    if (liteHead == NULL)
+        {
+        /* First lite task in the list */
+        liteHead = lt;
+        }
+    else
+        {
+        /* Inserts in the end of the SLL */
+        node = liteHead;
+        while (node->next != NULL)
+            {
+            if (node == lt)
+                {
+                SREG = sreg;
+                CRITICAL_LOG ("Fail on wLiteTaskStart - "
+                              "Lite task already started");
+                return ERROR;
+                }
+            node = node->next;
+            }
+
+        if (node == lt)
+            {
+            SREG = sreg;
+            CRITICAL_LOG ("Fail on wLiteTaskStart - Lite task already started");
+            return ERROR;
+            }
+
+        node->next = lt;
+        }
+    SREG = sreg;
+
+    /* Host may be asleep, forever if the list was empty - Wake it up */
+    (void) wTaskNotify (liteHost);
+
+    return OK;
+    }
+
+/* Signals an event and wakes the host - Task context */
+IMPORT void wLiteEventSignal(wLiteEvent_t * ev)
+    {
+    eventCount (ev);
+    (void) wTaskNotify (liteHost);
+    }
+
+/* wLiteEventSignal() for ISRs - Use within W_ISR to switch on ISR exit */
+IMPORT void wLiteEventSignalFromISR(wLiteEvent_t * ev)
+    {
+    eventCount (ev);
+    if (liteHost != NULL)
+        {
+        wTaskNotifyFromISR (liteHost);
+        }
+    }
+
+/* Takes one pending signal from the event - ERROR if none is pending */
+IMPORT STATUS wLiteEventTake(wLiteEvent_t * ev)
+    {
+    STATUS status = ERROR;
+    UINT8 sreg = SREG;
+
+    cli();
+    if (ev->count > 0)
+        {
+        ev->count--;
+        status = OK;
+        }
+    SREG = sreg;
+
+    return status;
+    }
+
+/*******************************************************************************
+* Private Lite Tasks functions
+*/
+
+/* Counts one signal on the event */
+LOCAL void eventCount (wLiteEvent_t * ev)
+    {
+    UINT8 sreg = SREG;
+
+    cli();
+    if (ev->count < 0xFF)
+        {
+        ev->count++;
+        }
+    SREG = sreg;
+    }
+
+/* Removes lt from the list - prev is NULL when lt is the head */
+LOCAL void unlinkLiteTask (wLiteTask_t * prev, wLiteTask_t * lt)
+    {
+    UINT8 sreg = SREG;
+
+    cli();
+    if (prev == NULL)
+        {
+        liteHead = lt->next;
+        }
+    else
+        {
+        prev->next = lt->next;
+        }
+    lt->next = NULL;
+    SREG = sreg;
+    }
+
+/* Host Task - Runs every lite task, sleeps if none made progress until
+ * the nearest WL_DELAY expires or an event is signalled */
+LOCAL void liteHostTask (void)
+    {
+    while (1)
+        {
+        wLiteTask_t * prev = NULL;
+        wLiteTask_t * lt = liteHead;
+        UINT8 progress = 0;
+        UINT16 timeout = W_WAIT_FOREVER;
+
+        while (lt != NULL)
+            {
+            UINT16 lc = lt->lc;
+            UINT8 result = lt->liteFn (lt);
+
+            if (result == LITE_EXITED)
+                {
+                unlinkLiteTask (prev, lt);
+                progress = 1;
+                }
+            else
+                {
+                /* A passed wait moves the continuation */
+                if (result == LITE_YIELDED || lt->lc != lc)
+                    {
+                    progress = 1;
+                    }
+                else if (result == LITE_WAITING)
+                    {
+                    /* Plain condition - Poll it on the next tick */
+                    timeout = 1;
+                    }
+                else if (result == LITE_DELAYED)
+                    {
+                    int32_t left = (int32_t)(lt->wakeTick - wTickGet());
+
+                    /* Reached meanwhile - Sleep the shortest wait */
+                    if (left < 1)
+                        {
+                        left = 1;
+                        }
+                    else if (left > 0xFFFF)
+                        {
+                        left = 0xFFFF;
+                        }
+
+                    if (timeout == W_WAIT_FOREVER || (UINT16) left < timeout)
+                        {
+                        timeout = (UINT16) left;
+                        }
+                    }
+                prev = lt;
+                }
+
+            /* Re-read next - a lite task may have been appended */
+            lt = (prev != NULL) ? prev->next : liteHead;
+            }
+
+        if (progress == 0)
+            {
+            /* Everyone is waiting - Signals notify the host, returns
+             * right away if one came during the pass */
+            (void) wTaskNotifyWait (timeout);
+            }
+        }
+    }
@@ -0,0 +1,146 @@
+/* uWireLite.h */
+
+#ifndef UWIRE_LITE_H
+#define UWIRE_LITE_H
+
+#include <stdint.h>
+#include "common.h"
+#include "uWire.h"
+#include "uWireLite.h"
+
+/*
+
+Lite tasks - stackless protothread-style tasks.
+
+All lite tasks run on the stack of a single host task created with
+wLiteHostCreate(). A lite task is a function that is re-entered from the
+top on every run and jumps back to where it left using the line number
+stored in its wLiteTask_t. Local variables DO NOT survive a wait or a
+yield - keep state in the wLiteTask_t arg or in static storage.
+
+Do not call blocking kernel APIs (wTaskDelay) from a lite task, use the
+WL_ macros instead. Do not use switch statements across a WL_ macro and
+keep at most one WL_ macro per source line.
+
+The host sleeps while every lite task waits. Signal events from ISRs
+with wLiteEventSignalFromISR() inside a W_ISR handler.
+
+    LOCAL UINT8 blinkLite (wLiteTask_t * lt)
+        {
+        WL_BEGIN (lt);
+        while (1)
+            {
+            PORTB ^= (1 << 5);
+            WL_DELAY (lt, 500 / TICK_MS);
+            }
+        WL_END (lt);
+        }
+
+*/
+
+#ifndef LITE_HOST_STACK
+#define LITE_HOST_STACK 128     /* Stack size for the lite host */
+#endif
+
+/* Lite task run results */
+#define LITE_WAITING 0          /* Blocked on a condition - Polled per tick */
+#define LITE_YIELDED 1          /* Gave up the CPU but can run again */
+#define LITE_EXITED  2          /* Finished - removed from the host */
+#define LITE_DELAYED 3          /* Blocked until wakeTick */
+#define LITE_EVENT   4          /* Blocked until an event is signalled */
+
+/* typedefs */
+
+struct liteTask;
+
+/* Lite Task Function pointer */
+typedef UINT8 (* wLiteHandler) (struct liteTask * lt);
+
+/* Lite Task Control Block */
+typedef struct liteTask
+    {
+    UINT16 lc;                      /* Local continuation - resume point */
+    UINT32 wakeTick;                /* Tick to resume at on WL_DELAY */
+    wLiteHandler liteFn;            /* Lite task routine */
+    void * arg;                     /* User argument */
+    struct liteTask * next;         /* Next lite task on the host */
+    } wLiteTask_t;
+
+/* Lite Event - counts signals not yet taken by a lite task */
+typedef struct liteEvent
+    {
+    volatile UINT8 count;
+    } wLiteEvent_t;
+
+/* Lite task macros */
+
+#define WL_BEGIN(lt)        switch ((lt)->lc) { case 0:
+
+#define WL_END(lt)          } (lt)->lc = 0; return LITE_EXITED
+
+/* Wait until cond is true - cond is re-evaluated on every host pass and
+ * at least once per tick. Prefer WL_WAIT_EVENT, it does not poll */
+#define WL_WAIT_UNTIL(lt, cond)                                     \
+    do                                                              \
+        {                                                           \
+        (lt)->lc = __LINE__; case __LINE__:                         \
+        if (!(cond))                                                \
+            {                                                       \
+            return LITE_WAITING;                                    \
+            }                                                       \
+        } while (0)
+
+/* Give the CPU to the other lite tasks */
+#define WL_YIELD(lt)                                                \
+    do                                                              \
+        {                                                           \
+        (lt)->lc = __LINE__; return LITE_YIELDED; case __LINE__:;   \
+        } while (0)
+
+/* Wait for a number of ticks - The host sleeps until wakeTick */
+#define WL_DELAY(lt, ticks)                                         \
+    do                                                              \
+        {                                                           \
+        (lt)->wakeTick = wTickGet() + (ticks);                      \
+        (lt)->lc = __LINE__; case __LINE__:                         \
+        if (!wLiteTickReached ((lt)->wakeTick))                     \
+            {                                                       \
+            return LITE_DELAYED;                                    \
+            }                                                       \
+        } while (0)
+
+/* Wait for an event to be signalled - The signal wakes the host */
+#define WL_WAIT_EVENT(lt, ev)                                       \
+    do                                                              \
+        {                                                           \
+        (lt)->lc = __LINE__; case __LINE__:                         \
+        if (wLiteEventTake (ev) != OK)                              \
+            {                                                       \
+            return LITE_EVENT;                                      \
+            }                                                       \
+        } while (0)
+
+/* Finish the lite task */
+#define WL_EXIT(lt)                                                 \
+    do                                                              \
+        {                                                           \
+        (lt)->lc = 0; return LITE_EXITED;                           \
+        } while (0)
+
+/* Tick comparison safe across the tick counter wrap */
+static inline UINT8 wLiteTickReached (UINT32 tick)
+    {
+    return (int32_t)(wTickGet() - tick) >= 0;
+    }
+
+/* Forward section */
+
+IMPORT wTask_t * wLiteHostCreate(void);
+IMPORT STATUS wLiteTaskStart(wLiteTask_t * lt,
+                            wLiteHandler liteFn,
+                            void * arg);
+IMPORT void wLiteEventSignal(wLiteEvent_t * ev);
+IMPORT void wLiteEventSignalFromISR(wLiteEvent_t * ev);
+IMPORT STATUS wLiteEventTake(wLiteEvent_t * ev);
+
+#endif /* UWIRE_LITE_H */
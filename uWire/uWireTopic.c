@@ -0,0 +1,172 @@
+/* uWireTopic.c */
+/*
+
+Topic lib.
+- Double buffered latest-sample topics
+- Zero-copy reads checked with a sequence number
+
+*/
+#include <stdio.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "common.h"
+#include "uWire.h"
+#include "uWireTopic.h"
+#include "log.h"
+
+/* Forward section */
+LOCAL UINT16 topicSeqGet (wTopic_t * topic);
+LOCAL void topicSeqBump (wTopic_t * topic);
+
+/*******************************************************************************
+* API Topic functions
+*/
+
+/* Init a topic - buffers holds 2 samples of size bytes, owned by caller */
+IMPORT STATUS wTopicInit(wTopic_t * topic, void * buffers, UINT8 size)
+    {
+    /* Sanity checks */
+    if (topic == NULL || buffers == NULL || size == 0U)
+        {
+        CRITICAL_LOG ("Fail on wTopicInit - Initial sanity checks");
+        return ERROR;
+        }
+
+    topic->seq = 0;
+    topic->size = size;
+    topic->buffers = (UINT8 *) buffers;
+
+    return OK;
+    }
+
+/* Starts a zero-copy publish - Returns the back buffer to fill in */
+IMPORT void * wTopicWriteBegin(wTopic_t * topic)
+    {
+    /* Odd - Readers keep using the front buffer */
+    topicSeqBump (topic);
+
+    /* Back buffer - Becomes front once seq is even again */
+    return &topic->buffers[(((topic->seq >> 1) + 1U) & 1U) * topic->size];
+    }
+
+/* Ends a publish - Flips the buffers and wakes the waiting subscribers */
+IMPORT void wTopicWriteEnd(wTopic_t * topic)
+    {
+    topicSeqBump (topic);
+    wTaskWakeObject (topic);
+    }
+
+/* wTopicWriteEnd() for ISRs - Switch happens on W_ISR exit */
+IMPORT void wTopicWriteEndFromISR(wTopic_t * topic)
+    {
+    topicSeqBump (topic);
+    wTaskWakeObjectFromISR (topic);
+    }
+
+/* Publishes a copy of sample */
+IMPORT void wTopicPublish(wTopic_t * topic, const void * sample)
+    {
+    (void) memcpy (wTopicWriteBegin (topic), sample, topic->size);
+    wTopicWriteEnd (topic);
+    }
+
+/* Publishes a copy of sample from an ISR */
+IMPORT void wTopicPublishFromISR(wTopic_t * topic, const void * sample)
+    {
+    (void) memcpy (wTopicWriteBegin (topic), sample, topic->size);
+    wTopicWriteEndFromISR (topic);
+    }
+
+/* Starts a read - Returns the latest sample in place, NULL if none yet
+ * The sample is only valid if wTopicReadEnd() returns OK */
+IMPORT const void * wTopicReadBegin(wTopic_t * topic, UINT16 * seq)
+    {
+    UINT16 now = topicSeqGet (topic);
+
+    *seq = now;
+
+    /* Nothing published - 1st publish still writing */
+    if (now < 2U)
+        {
+        return NULL;
+        }
+
+    return &topic->buffers[((now >> 1) & 1U) * topic->size];
+    }
+
+/* Ends a read - ERROR if the publisher wrote over the sample meanwhile */
+IMPORT STATUS wTopicReadEnd(wTopic_t * topic, UINT16 seq)
+    {
+    UINT16 elapsed = topicSeqGet (topic) - seq;
+
+    /* The front buffer read at seq is written again by the publish after
+     * next - It starts 3 bumps after an even seq, 2 after an odd one */
+    if (elapsed >= (3U - (seq & 1U)))
+        {
+        return ERROR;
+        }
+
+    return OK;
+    }
+
+/* Waits for a sample newer than *lastSeq - timeout in ticks or
+ * W_WAIT_FOREVER. Updates *lastSeq, returns ERROR on timeout */
+IMPORT STATUS wTopicWait(wTopic_t * topic, UINT16 * lastSeq, UINT16 timeout)
+    {
+    UINT16 now = 0;
+
+    while (1)
+        {
+        cli();  /* Disable ISR - No publish between check and wait */
+
+        /* Last complete publish */
+        now = topic->seq & ~1U;
+
+        if (now != (*lastSeq & ~1U))
+            {
+            sei();
+            *lastSeq = now;
+            return OK;
+            }
+
+        /* Returns with ISR enabled */
+        if (wTaskWaitObject (topic, timeout) != OK)
+            {
+            return ERROR; /* Timed out */
+            }
+        }
+    }
+
+/*******************************************************************************
+* Private Topic functions
+*/
+
+/* 16-bit seq read is not atomic on AVR */
+LOCAL UINT16 topicSeqGet (wTopic_t * topic)
+    {
+    UINT16 seq = 0;
+    UINT8 sreg = SREG;
+
+    cli();
+    seq = topic->seq;
+    SREG = sreg;
+
+    return seq;
+    }
+
+/* 16-bit seq update is not atomic on AVR */
+LOCAL void topicSeqBump (wTopic_t * topic)
+    {
+    UINT8 sreg = SREG;
+
+    cli();
+    topic->seq++;
+
+    /* Wrap to 4 - 0 and 1 mean nothing published, same front buffer */
+    if (topic->seq == 0U)
+        {
+        topic->seq = 4;
+        }
+    SREG = sreg;
+    }
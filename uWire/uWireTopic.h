@@ -0,0 +1,71 @@
+/* uWireTopic.h */
+
+#ifndef UWIRE_TOPIC_H
+#define UWIRE_TOPIC_H
+
+#include "common.h"
+#include "uWire.h"
+#include "uWireTopic.h"
+
+/*
+
+Topics - Latest-sample publish/subscribe.
+
+A topic keeps the latest sample in one of two buffers. The publisher
+writes the back buffer and flips it to the front. Subscribers read the
+front buffer in place, without copying and without locking the
+publisher out. The sequence number tells a reader if its buffer was
+overwritten while it was reading. A topic costs the same memory for any
+number of subscribers. Each subscriber keeps its own last seen sequence.
+
+One publisher per topic.
+
+    W_TOPIC_DEFINE (imuTopic, imuSample_t);
+
+    Publisher:
+        wTopicPublish (&imuTopic, &sample);
+
+    Subscriber:
+        UINT16 seq = 0;
+        while (1)
+            {
+            wTopicWait (&imuTopic, &seq, W_WAIT_FOREVER);
+            do
+                {
+                const imuSample_t * s = wTopicReadBegin (&imuTopic, &seq);
+                use (s);
+                } while (wTopicReadEnd (&imuTopic, seq) != OK);
+            }
+
+*/
+
+/* typedefs */
+
+/* Topic - seq is even when idle, odd while the publisher writes */
+typedef struct topic
+    {
+    volatile UINT16 seq;            /* Bumped twice per publish */
+    UINT8 size;                     /* Sample size in bytes */
+    UINT8 * buffers;                /* 2 . size bytes - Front is (seq/2)&1 */
+    } wTopic_t;
+
+/* Defines a topic and its two sample buffers */
+#define W_TOPIC_DEFINE(name, type)                                  \
+    _Static_assert (sizeof (type) <= 255,                           \
+                    "Topic sample " #type " exceeds 255 bytes");    \
+    LOCAL type name##Buffers [2];                                   \
+    wTopic_t name = { 0, sizeof (type), (UINT8 *) name##Buffers }
+
+/* Forward section */
+
+IMPORT STATUS wTopicInit(wTopic_t * topic, void * buffers, UINT8 size);
+IMPORT void * wTopicWriteBegin(wTopic_t * topic);
+IMPORT void wTopicWriteEnd(wTopic_t * topic);
+IMPORT void wTopicWriteEndFromISR(wTopic_t * topic);
+IMPORT void wTopicPublish(wTopic_t * topic, const void * sample);
+IMPORT void wTopicPublishFromISR(wTopic_t * topic, const void * sample);
+IMPORT const void * wTopicReadBegin(wTopic_t * topic, UINT16 * seq);
+IMPORT STATUS wTopicReadEnd(wTopic_t * topic, UINT16 seq);
+IMPORT STATUS wTopicWait(wTopic_t * topic, UINT16 * lastSeq, UINT16 timeout);
+
+#endif /* UWIRE_TOPIC_H */